@@ -0,0 +1,129 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <vector>
+#include <string>
+using namespace std;
+
+#include "page.h"
+#include "buf.h"
+
+enum Datatype { STRING, INTEGER, FLOAT };    // attribute data types
+enum Operator { LT, LTE, EQ, GTE, GT, NE };  // scan operators
+
+// The first page of an index file describes the index.
+struct BTreeMeta
+{
+  int		root;		// pageNo of the root node
+  int		levels;		// number of levels, 1 while the root is a leaf
+  int		entries;	// number of entries
+  int		offset;		// byte offset of the key in a record
+  int		length;		// length of the key
+  Datatype	type;		// datatype of the key
+};
+
+// Every other page is a node: this header followed by a sorted array of
+// entries.  A leaf entry is a key followed by the RID of its record; an
+// entry of an internal node adds the pageNo of the child holding the
+// entries at or above it, and first is the child holding those below
+// its first entry.
+struct BTreeNode
+{
+  int		level;		// 0 for leaves
+  int		count;		// number of entries
+  int		next;		// leaves: next leaf, -1 for the last one
+  int		first;		// internal nodes: child below the first entry
+};
+
+
+// A B+-tree over one attribute of the records of a heap file, mapping
+// attribute values to the RIDs of the records that hold them.  It lives
+// in a file of its own and is read and written through the buffer pool
+// like a heap file.  Entries are ordered by key and then by RID, so
+// records with equal keys are told apart and every entry can be found
+// exactly when its record is deleted.  Deletions do not merge nodes; a
+// leaf that empties stays in the chain.
+
+class BTreeIndex
+{
+public:
+
+  // Where a scan is in the index: a copy of the entries of the current
+  // leaf, so that records can be deleted while the scan is on it.
+  struct Cursor
+  {
+    vector<char> leaf;	// entries of the current leaf
+    int count;		// number of entries in leaf
+    int pos;		// entry the scan is at
+    int next;		// leaf after this one, -1 if none
+
+    Cursor() : count(0), pos(0), next(-1) {}
+  };
+
+  // create an empty index file over (offset, length, type)
+  static const Status create(const string & name, const int offset,
+			     const int length, const Datatype type,
+			     const int pageSize);
+
+  // open an index file, pinning its first page
+  BTreeIndex(const string & name, Status & status);
+  ~BTreeIndex();
+
+  const int getOffset() const { return meta->offset; }
+  const int getLength() const { return meta->length; }
+  const Datatype getType() const { return meta->type; }
+  const int getEntryCnt() const { return meta->entries; }
+
+  // the key of rec, or NULL if the record is too short to hold one
+  const char* keyOf(const Record & rec) const;
+
+  // < 0, 0 or > 0 as key a is below, equal to or above key b
+  const int compare(const char* a, const char* b) const;
+
+  // add the entry for the record at rid with the given key; an entry
+  // that is already there is NONUNIQUEENTRY
+  const Status insertEntry(const char* key, const RID & rid);
+
+  // remove the entry for the record at rid; RECNOTFOUND if none
+  const Status deleteEntry(const char* key, const RID & rid);
+
+  // position cur at the first entry with a key at or above key (above
+  // it if after is set), or at the first entry of all if key is NULL
+  const Status seek(const char* key, const bool after, Cursor & cur);
+
+  // return the entry at cur without moving past it; NOMORERECS once
+  // the last leaf has been passed
+  const Status peek(Cursor & cur, RID & rid, const char*& key);
+
+  // move past the entry at cur
+  void advance(Cursor & cur) { cur.pos++; }
+
+private:
+  File*		file;		// index file
+  int		metaPageNo;	// pageNo of the pinned first page
+  BTreeMeta*	meta;		// the pinned first page
+  bool		metaDirty;	// true if meta has been updated
+  int		pageSize;	// size of the pages of the file
+  int		leafSize;	// bytes in a leaf entry: key and RID
+  int		nodeSize;	// bytes in an internal entry: leaf entry and child
+  int		leafCap;	// entries that fit in a leaf
+  int		nodeCap;	// entries that fit in an internal node
+
+  char* entries(BTreeNode* node) const { return (char*) (node + 1); }
+  int entrySize(const BTreeNode* node) const
+  {
+    return node->level ? nodeSize : leafSize;
+  }
+  int childAt(BTreeNode* node, const int i) const;
+  // compare two leaf entries, or the leading (key, RID) of larger ones
+  const int compareEntry(const char* a, const char* b) const;
+  // number of entries of node below e, or at or below it if upper is set
+  int bound(BTreeNode* node, const char* e, const bool upper) const;
+  const Status insertAt(const int pageNo, const char* e, vector<char> & up,
+			bool & split);
+  const Status insertInto(BTreeNode* node, const int i, const char* e,
+			  vector<char> & up, bool & split);
+  const Status loadLeaf(const int pageNo, Cursor & cur);
+};
+
+#endif
@@ -1,31 +1,76 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
 #include "db.h"
 // define if debug output wanted
 //#define DEBUGBUF
 
 // declarations for buffer pool hash table
-struct hashBucket
+struct hashSlot
 {
-	File*	file;    // pointer a file object (more on this below)
+	const File* file;    // pointer to the file object
 	int	pageNo;  // page number within a file
 	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
 };
 
 
-// hash table to keep track of pages in the buffer pool
+// hash table to keep track of pages in the buffer pool.  The table is
+// divided among NUMPARTS partitions, each protected by its own latch,
+// so that threads working on different pages do not contend.
+// insert, lookup and remove do not latch anything themselves: the
+// caller must hold the latch of the partition the (file,pageNo) pair
+// maps to, which lets the buffer manager make a lookup and the pin
+// that follows it a single atomic step.
+//
+// Each partition is a flat array of slots with Robin Hood linear
+// probing: an entry is kept no further from its home slot than the
+// entries it passed over.  A byte per slot records how far the entry
+// in it is from home, so a lookup only compares keys in slots at the
+// right distance and stops at the first one closer to home than that.
+// Removal shifts the entries after it back instead of leaving
+// tombstones.  A partition doubles when it gets 7/8 full; entries take
+// no memory of their own.
 class BufHashTbl
 {
 private:
-    int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    struct alignas(64) Partition
+    {
+	std::mutex latch;  // protects the fields below
+	hashSlot* slots;   // mask+1 slots
+	unsigned char* dist; // per slot: 0 if empty, else 1 + distance from home
+	unsigned mask;     // number of slots - 1, a power of two - 1
+	unsigned count;    // slots in use
+    };
+
+    int NUMPARTS;
+    Partition* parts;
+
+    // mixes all bits of file and pageNo; the high half picks the
+    // partition and the low half the home slot within it
+    static unsigned long hash(const File* file, const int pageNo);
+    void allocSlots(Partition & part, const unsigned size);
+    void grow(Partition & part);  // double the slots of part
 
 public:
-    BufHashTbl(const int htSize);  // constructor
+    BufHashTbl(const int htSize, const int numParts = 16);  // constructor
     ~BufHashTbl(); // destructor
+
+    // returns the partition that (file,pageNo) belongs to
+    int partition(const File* file, const int pageNo)
+    {
+	return (hash(file, pageNo) >> 32) % NUMPARTS;
+    }
+
+    // latch protecting partition part
+    std::mutex & latch(const int part)
+    {
+	return parts[part].latch;
+    }
 	
     // insert entry into hash table mapping (file,pageNo) to frameNo;
     // returns 0 if OK, HASHTBLERROR if an error occurred
@@ -43,18 +88,30 @@ public:
 
 
 class BufMgr;  //forward declaration of BufMgr class 
+class BufPolicy;
 
-// class for maintaining information about buffer pool frames
-class BufDesc {
+// class for maintaining information about buffer pool frames.
+// pinCnt is only changed while holding the latch of the hash partition
+// the page belongs to; file, pageNo, page and size are only changed
+// while holding the frame latch, which is also held for the duration
+// of any I/O that replaces the frame contents.
+class alignas(64) BufDesc {
     friend class BufMgr;
+    friend class BufPolicy;
 private:
   File* file;   // pointer to file object
   int   pageNo; // page within file
   int	frameNo;  // frame # of frame
-  int   pinCnt; // number of times this page has been pinned
-  bool 	dirty;	  // true if dirty;  false otherwise
-  bool 	valid;   // true if page is valid
-  bool  refbit;	 // has this buffer frame been reference recently
+  Page* page;	// memory of the frame
+  int	size;	// bytes at page, the largest page size it can hold
+  std::atomic<int>  pinCnt; // number of times this page has been pinned
+  std::atomic<bool> dirty;  // true if dirty;  false otherwise
+  std::atomic<bool> valid;  // true if page is valid
+  std::atomic<bool> refbit; // has this buffer frame been reference recently
+  std::atomic<bool> prefetched; // read ahead and not referenced since
+  std::atomic<bool> writing; // being written out by the latch holder
+  std::atomic<LSN> lsn;	 // last logged change to the page, 0 if none
+  std::mutex latch;	 // held while the frame is being (re)assigned
 
   void Clear() {  // initialize buffer frame for a new user
     	pinCnt = 0;
@@ -62,6 +119,9 @@ private:
 	pageNo = -1;
     	dirty = false;
 	valid = false;
+	prefetched = false;
+	writing = false;
+	lsn = 0;
   };
 
   void Set(File* filePtr, int pageNum) { 
@@ -71,23 +131,105 @@ private:
       dirty = false;
       valid = true;
       refbit = true;
+      prefetched = false;
+      lsn = 0;
   }
 
   BufDesc() {
       Clear();
+      refbit = false;
+      page = NULL;
+      size = 0;
   }
 };
 
 
+// memory that BufMgr can keep its frames in
+enum PoolMemory {
+  SMALLPAGES,		// ordinary pages of the system page size
+  TRANSPARENTHUGE,	// ask the kernel to back the pool with 2 MB pages
+  EXPLICITHUGE		// reserved 2 MB pages (MAP_HUGETLB); transparent
+			// ones if not enough are reserved
+};
+
+
+// page replacement policies that BufMgr can be constructed with
+enum ReplPolicy {
+  CLOCK,	// second-chance clock over the refbits; needs no global latch
+  LRUK,		// LRU-2: evict the largest backward distance to the 2nd last use
+  TWOQ,		// 2Q: new pages go to a FIFO, reused ones to an LRU queue
+  ARC		// adaptive replacement cache, balances recency and frequency
+};
+
+
+// Replacement policy other than the clock.  BufMgr reports every hit,
+// load, eviction and release of a frame, and asks for candidate victims
+// when it needs a free frame.  Implementations keep their own latch
+// since their bookkeeping is shared by all frames.
+class BufPolicy
+{
+public:
+  virtual ~BufPolicy() {}
+
+  // a policy for bufs frames that can grow to maxBufs
+  static BufPolicy* create(const ReplPolicy policy, const int bufs,
+			   const int maxBufs);
+
+  // the pool now has bufs frames.  When it shrinks, the frames that go
+  // have been freed or evicted before.
+  virtual void resize(const int bufs) = 0;
+
+  virtual void touch(const int frame) = 0;	// page in frame was hit
+  virtual void loaded(const int frame,	// frame now holds (file,pageNo)
+		      const File* file, const int pageNo) = 0;
+  virtual void evicted(const int frame,	// (file,pageNo) was replaced
+		       const File* file, const int pageNo) = 0;
+  virtual void freed(const int frame) = 0; // frame emptied, not replaced
+
+  // fill frames with up to max replacement candidates, best first.
+  // Unused frames come before resident ones, and frames that are pinned
+  // right now are skipped.  Returns the number of candidates.
+  virtual int victims(int* frames, const int max,
+		      const BufDesc* bufTable) = 0;
+
+protected:
+  static bool pinned(const BufDesc & buf) { return buf.pinCnt > 0; }
+};
+
+
 struct BufStats
 {
-  int accesses;    // Total number of accesses to buffer pool
-  int diskreads;   // Number of pages read from disk (including allocs)
-  int diskwrites;  // Number of pages written back to disk
+  std::atomic<int> accesses;    // Total number of accesses to buffer pool
+  std::atomic<int> hits;        // Accesses to pages already in the pool
+  std::atomic<int> misses;      // Accesses that read or allocated a page
+  std::atomic<int> pinWaits;    // Hits that waited for a read or a write
+  std::atomic<int> evictions;   // Pages replaced to free their frame
+  std::atomic<int> dirtyEvictions; // Of those, pages written back first
+  std::atomic<int> sweeps;      // Searches for a frame to replace
+  std::atomic<long> sweepSteps; // Frames (or candidates) looked at by them
+  std::atomic<int> maxSweep;    // Most frames looked at by one of them
+  std::atomic<int> diskreads;   // Number of pages read from disk (including allocs)
+  std::atomic<int> diskwrites;  // Number of pages written back to disk
+  std::atomic<int> prefetches;  // Pages read ahead (also in diskreads)
+  std::atomic<int> prefetchHits; // Read-ahead pages later requested
+  std::atomic<int> prefetchUnused; // Read-ahead pages evicted unrequested
+  std::atomic<int> cleanerWrites; // Pages written by the background writer
+  std::atomic<int> coalescedWrites; // Writes covering more than one page
+  std::atomic<int> dirtyStalls;  // Requests that waited to write a victim
+  std::atomic<int> sharedJoins;  // Shared scans that joined others under way
+  std::atomic<int> sharedHits;   // Pages shared scans found in the pool while
+				 // others ran with them: reads saved
 
   void clear()
     {
-      accesses = diskreads = diskwrites = 0;
+      accesses = hits = misses = pinWaits = 0;
+      evictions = dirtyEvictions = 0;
+      sweeps = maxSweep = 0;
+      sweepSteps = 0;
+      diskreads = diskwrites = 0;
+      prefetches = prefetchHits = prefetchUnused = 0;
+      cleanerWrites = coalescedWrites = dirtyStalls = 0;
+      sharedJoins = sharedHits = 0;
     }
       
   BufStats()
@@ -97,27 +239,101 @@ struct BufStats
 };
 
 
+// The buffer manager may be used by several threads at once.  Lookups
+// latch only the hash partition of the requested page, pin counts are
+// atomic, and the clock hand is advanced with an atomic increment so
+// that concurrent replacements sweep different frames.
+//
+// Dirty pages are written back when their frame is reused, unless the
+// background writer has cleaned them before.  Whenever a write covers
+// pages that are consecutive in a file, they go out in one system call.
+// With a write-ahead log, no page is written before the log has been
+// flushed past the last change logged for it.
+//
+// Files may have different page sizes.  Every frame starts out as
+// DEFAULTPAGESIZE bytes of one contiguous pool; a frame that is needed
+// for a larger page is given memory of its own, which it keeps.  All
+// frame memory is aligned for direct I/O.
+//
+// The pool is an arena of address space for maxBufs frames, aligned to
+// 2 MB so that it can be backed by huge pages; only the part in use is
+// backed by memory.  resize() moves the number of frames within that
+// while other threads go on using the pool.
+
 class BufMgr 
 {
 private:
-  unsigned int 	 clockHand;
-  int   	 numBufs;    	// Number of pages in buffer pool
+  std::atomic<unsigned int> clockHand;
+  BufPolicy*	 policy;	// replacement policy, NULL for the clock
+  std::atomic<int> numBufs;	// Number of frames to replace pages in
+  std::atomic<int> allBufs;	// Frames that may hold pages: numBufs, or
+				// more while resize() drains frames
+  int		 maxBufs;	// frames the arena has room for
+  std::mutex	 resizeLatch;	// serializes resize()
   BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
   BufStats	 bufStats;	// buffer pool statistics
+  std::atomic<int> prefetchedBufs; // frames holding unreferenced read-ahead
+  std::atomic<int> maxPrefetched; // bound on prefetchedBufs
+  std::atomic<int> dirtyBufs;	// frames holding dirty pages
+  LogMgr*	 log;		// write-ahead log, NULL if none
 
-  const Status allocBuf(int & frame);   // allocate a free frame.  
+  // background writer
+  std::thread*	 writer;	// NULL unless started
+  std::mutex	 writerLatch;	// protects the fields below
+  std::condition_variable writerWake; // signalled to start cleaning
+  bool		 writerStop;	// set to make the writer exit
+  std::atomic<int> dirtyLow;	// frames that may stay dirty after cleaning
+  std::atomic<int> dirtyHigh;	// dirty frames that wake the writer
+  double	 writerLow;	// dirtyLow and dirtyHigh as fractions of
+  double	 writerHigh;	// the pool, kept for resize()
+
+  const Status allocBuf(int & frame, const bool prefetch = false); // allocate a free frame.  
   const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
+  const Status claimBuf(const int frame, bool & claimed,
+		       const bool drain = false); // try to take frame
+  bool startWrite(BufDesc* buf, const bool pinned); // before writing a frame
+  const Status fitBuf(const int frame, const int size); // make frame hold size bytes
+  void dropPrefetched(BufDesc* buf); // frame's read-ahead page goes unused
+  void markDirty(BufDesc* buf)	// set the dirty bit, counting dirty frames
+  {
+	if (! buf->dirty.exchange(true)) dirtyBufs++;
+  }
+  void markClean(BufDesc* buf)	// clear the dirty bit
+  {
+	if (buf->dirty.exchange(false)) dirtyBufs--;
+  }
+  const Status writeFrames(const std::vector<int> & frames, const bool wait,
+			   int & written, const File* file = NULL);
+				// write dirty pages, coalescing runs
+  const Status forceLog(const LSN lsn); // flush the log past lsn
+  void cleanAhead();		// one round of the background writer
+  void writerLoop();		// body of the background writer thread
+  const Status pinPage(File* file, const int PageNo, int & frameNo,
+		       const bool prefetch); // common part of readPage and prefetchPage
+  void counted(File* file, const bool hit) // count an access to file
   {
-	clockHand = (clockHand + 1) % numBufs;
+	bufStats.accesses++;
+	(hit ? bufStats.hits : bufStats.misses)++;
+	(hit ? file->getStats().hits : file->getStats().misses)++;
   }
+  void swept(const int steps);	// count a search for a victim
+  int advanceClock() // returns the frame under the advanced hand
+  {
+	return (clockHand.fetch_add(1) + 1) % numBufs;
+  }
+
 
+  char*		 bufPool;	// DEFAULTPAGESIZE bytes for each frame
+  size_t	 poolBytes;	// size of the arena at bufPool
+  bool		 poolHuge;	// arena is backed by explicit huge pages
 
 public:
-  Page*	         bufPool;   // actual buffer pool
 
-  BufMgr(const int bufs);
+  // maxBufs bounds what resize() can grow the pool to; 0 leaves room
+  // for four times bufs
+  BufMgr(const int bufs, const ReplPolicy replPolicy = CLOCK,
+	 const PoolMemory memory = SMALLPAGES, const int maxBufs = 0);
   ~BufMgr();
 
   const Status readPage(File* file, const int PageNo, Page*& page);
@@ -125,9 +341,53 @@ public:
   const Status allocPage(File* file, int& PageNo, Page*& page); 
                         // allocates a new, empty page 
   const Status flushFile(const File* file); // writing out all dirty pages of the file
+  const Status writeFile(const File* file); // same, but leave them in the pool
   const Status disposePage(File* file, const int PageNo); // dispose of page in file
+  const int dirtyPages(const File* file); // pages of file not yet written back
+  const bool resident(const File* file, const int PageNo); // page is in the pool
+
+  // Start a thread that writes dirty, unpinned pages back before their
+  // frames are needed, or change its thresholds if it is running.  The
+  // writer always cleans the frames that are next in line for
+  // replacement; once more than high (a fraction of the pool) of the
+  // frames are dirty it goes on until no more than low are.
+  void startWriter(const double low = 0.1, const double high = 0.3);
+  void stopWriter();
+
+  // Bring a page into the pool ahead of its use without leaving it
+  // pinned, and return its nextPage link.  Only frames that are free or
+  // unreferenced are taken, and no more than a quarter of the pool may
+  // hold read-ahead pages that have not been requested yet; otherwise
+  // BUFFEREXCEEDED is returned and nothing is read.
+  const Status prefetchPage(File* file, const int PageNo, int & nextPageNo);
   void  printSelf();
 
+  // From now on write pages back only once log has been flushed past
+  // the last change logged for them; NULL stops checking.
+  void setLog(LogMgr* log) { this->log = log; }
+
+  // The pinned page (file,pageNo) has been changed by the change logged
+  // at lsn.  The page is marked dirty, so that a checkpoint writes it
+  // even while it stays pinned.
+  void logged(File* file, const int PageNo, const LSN lsn);
+
+  // Change the number of frames to bufs, at most maxBufs.  New frames
+  // start out free.  To shrink, the frames at the end of the pool are
+  // written back if dirty and emptied, and their memory is returned to
+  // the system; a pinned page stops the shrinking there, leaving the
+  // pool as small as it could get, and PAGEPINNED is returned.
+  const Status resize(const int bufs);
+  const int getBufCount() const { return numBufs; }
+
+  // Write the buffer pool statistics, the system call counts and
+  // latency histograms of database, and the counters of each of its
+  // files as one line of JSON, under the given label.
+  void  dumpStats(ostream & os, DB & database, const string & label) const;
+
+  // shared heap file scans count their savings here
+  void sharedJoin() { bufStats.sharedJoins++; }
+  void sharedHit() { bufStats.sharedHits++; }
+
   const BufStats & getBufStats() const // get buffer pool usage
   {
 	return bufStats;
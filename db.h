@@ -3,7 +3,13 @@
 
 #include <sys/types.h>
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <iostream>
 #include "error.h"
+#include "page.h"
 #include <string.h>
 using namespace std;
 
@@ -14,6 +20,103 @@ using namespace std;
 
 // forward class definition for db
 class DB;
+class LogMgr;
+
+// structure of DB (header) page
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list
+  int firstPage;                        // page # of first page in file
+  int numPages;                         // total # of pages in file
+  int pageSize;                         // size of each page in bytes
+} DBPage;
+
+
+// Files opened for direct I/O need buffers aligned to IOALIGN, so only
+// files whose page size is a multiple of it use direct I/O.  allocIOBuf
+// returns zeroed memory aligned that way; it must be released with
+// freeIOBuf.
+const unsigned IOALIGN = 4096;
+void* allocIOBuf(const size_t bytes);
+void freeIOBuf(void* buf);
+
+
+// Distribution of the latencies of some call.  Bucket b counts calls
+// that took from 2^b up to 2^(b+1) nanoseconds, the last bucket also
+// the longer ones.
+struct LatencyHist
+{
+  static const int BUCKETS = 32;
+  std::atomic<long> counts[BUCKETS];
+
+  void add(const long nanos);
+  // upper bound of the bucket holding the fraction p of the calls
+  const long percentile(const double p) const;
+  // "[c0, c1, ...]", with trailing empty buckets left out
+  void print(ostream & os) const;
+
+  void clear()
+    {
+      for (int b = 0; b < BUCKETS; b++) counts[b] = 0;
+    }
+
+  LatencyHist()
+    {
+      clear();
+    }
+};
+
+// counts of the system calls made by File, and the time spent in them
+struct IOStats
+{
+  std::atomic<long> reads;       // pread calls
+  std::atomic<long> writes;      // pwrite and pwritev calls
+  std::atomic<long> truncates;   // ftruncate calls, used to extend files
+  std::atomic<long> readBytes;   // bytes read
+  std::atomic<long> writeBytes;  // bytes written
+  std::atomic<long> readNanos;   // time spent in pread
+  std::atomic<long> writeNanos;  // time spent in pwrite and pwritev
+  LatencyHist readLatency;       // of each pread of a page
+  LatencyHist writeLatency;      // of each pwrite or pwritev
+
+  void clear()
+    {
+      reads = writes = truncates = 0;
+      readBytes = writeBytes = 0;
+      readNanos = writeNanos = 0;
+      readLatency.clear();
+      writeLatency.clear();
+    }
+
+  IOStats()
+    {
+      clear();
+    }
+};
+
+// What happened to the pages of one file.  The DB keeps these by file
+// name, so that they outlast the opening of the file; the buffer
+// manager counts the requests and File its system calls.
+struct FileStats
+{
+  std::atomic<long> hits;        // requests for pages already in the pool
+  std::atomic<long> misses;      // requests that had to read or allocate
+  std::atomic<long> evictions;   // pages that lost their frame
+  std::atomic<long> dirtyEvictions; // of those, pages written back first
+  std::atomic<long> reads;       // pages read from the file
+  std::atomic<long> writes;      // pages written to the file
+
+  void clear()
+    {
+      hits = misses = evictions = dirtyEvictions = 0;
+      reads = writes = 0;
+    }
+
+  FileStats()
+    {
+      clear();
+    }
+};
 
 // class definition for open files
 class File {
@@ -23,12 +126,29 @@ class File {
  public:
 
   Status allocatePage(int& pageNo);     // allocate a new page
+  const Status allocatePages(const int count,
+			     int& firstPageNo); // extend file by count pages
+  const Status releasePages(const int firstPageNo,
+			    const int count);  // give back unused pages
   const Status disposePage(const int pageNo);       // release space for a page
   const Status readPage(const int pageNo,
 		  Page* pagePtr) const;       // read page from file
   const Status writePage(const int pageNo,
 		   const Page* pagePtr);      // write page to file
+  const Status writePages(const int pageNo, const int count,
+			  const Page* pages); // write consecutive pages
+  const Status writePages(const int pageNo, const int count,
+			  const Page* const* pages); // same, gathered
   const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  const Status sync();                  // write back header, force file to disk
+  const string & getName() const { return fileName; } // name of the file
+  const int getPageSize() const;        // returns size of the pages of the file
+  const bool isDirect() const;          // true if opened for direct I/O
+  FileStats & getStats() const { return *stats; } // counters of the file
+  const Status map(const char*& base,
+		   size_t& length) const;   // map whole file read-only
+  static void unmap(const char* base,
+		    const size_t length);   // undo map
 
   bool operator == (const File & other) const
     {
@@ -37,19 +157,24 @@ class File {
 
  private: 
 
-  File(const string &fname);                   // initialize
+  File(const string &fname, FileStats* fstats); // initialize
   ~File();                  // deallocate file object
 
-  static const Status create(const string &fileName);
+  static const Status create(const string &fileName, const int pageSize);
   static const Status destroy(const string &fileName);
 
-  const Status open();
+  const Status open(const bool direct);
   const Status close();
 
   const Status intread(const int pageNo,
 		 Page* pagePtr) const;        // internal file read
   const Status intwrite(const int pageNo,
 		  const Page* pagePtr);       // internal file write
+  const Status intwrite(const int pageNo, const int count,
+		  const Page* pages);         // write consecutive pages
+  const Status hdrread(const int pageNo,
+		 DBPage & hdr) const;         // read DBPage at start of page
+  const Status flushHeader();           // write back header if changed
 
 #ifdef DEBUGFREE
   void listFree();                      // list free pages
@@ -58,6 +183,18 @@ class File {
   string fileName;                    // The name of the file
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  int pageSize;                       // page size, read from header on open
+  bool direct;                        // opened with O_DIRECT
+
+  // The header page is read when the file is opened and written back
+  // when it is closed; in between it is only changed in memory.
+  DBPage header;                      // cached header page
+  bool hdrDirty;                      // header changed since written
+  mutable std::mutex hdrLatch;        // protects header and hdrDirty
+
+  FileStats* stats;                   // counters kept by the DB
+
+  static IOStats ioStats;             // system calls of all files
 };
 
 class BufMgr;
@@ -72,7 +209,8 @@ struct fileHashBucket
 	
 };
 
-// hash table to keep track of open files
+// hash table to keep track of open files.  Not latched; DB serializes
+// all access to it.
 class OpenFileHashTbl
 {
 private:
@@ -103,23 +241,52 @@ class DB {
   DB();                                 // initialize open file table
   ~DB();                                // clean up any remaining open files
 
-  const Status createFile(const string & fileName) ;  // create a new file
+  const Status createFile(const string & fileName,
+			  const int pageSize = DEFAULTPAGESIZE); // create a new file
   const Status destroyFile(const string & fileName) ; // destroy a file, 
                                                            // release all space
   const Status openFile(const string & fileName, File* & file);  // open a file
   const Status closeFile(File* file);         // close a file
 
- private:
-  OpenFileHashTbl   openFiles;    // list of open files
-};
+  // Open files with O_DIRECT from now on, bypassing the kernel page
+  // cache, or stop doing so.  Files already open are not affected, and
+  // files with pages smaller than IOALIGN, or on file systems without
+  // direct I/O, are opened normally.
+  void setDirectIO(const bool on);
 
+  const IOStats & getIOStats() const;   // system call counts and times
+  void clearIOStats();                  // also clears the counts of files
 
-// structure of DB (header) page
+  // names of the files that have counters, in order, and the counters
+  // of one of them (NULL if it was never opened)
+  void statFiles(vector<string> & names);
+  const FileStats* getFileStats(const string & fileName);
 
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
+  // Recover from the write-ahead log in logName, if it has records, and
+  // log every change to heap files there from then on.  Call it before
+  // opening any of the files the log covers, once bufMgr exists, as the
+  // buffer manager holds pages back until their changes are logged.
+  const Status openLog(const string & logName);
+  // The files above the DB that keep more than the log covers, such as
+  // heap files with B+-tree indexes, set a hook that openLog calls on
+  // every file recovery redid records for, once logging has started.
+  typedef const Status (*RecoveryHook)(const string & fileName);
+  static void setRecoveryHook(const RecoveryHook hook) { recoveryHook = hook; }
+  // checkpoint, then stop logging
+  const Status closeLog();
+  // Write back and sync every file changed since the log was last
+  // truncated, then truncate it.  The log is kept if records were
+  // added meanwhile.
+  const Status checkpoint();
+  LogMgr* getLog() const { return log; } // NULL unless logging
+
+ private:
+  OpenFileHashTbl   openFiles;    // list of open files
+  map<string, FileStats> fileStats; // counters by file name
+  std::mutex        dbLatch;      // protects openFiles and open counts
+  bool              directIO;     // open files with O_DIRECT
+  LogMgr*           log;          // write-ahead log, NULL if none
+  static RecoveryHook recoveryHook; // NULL if none
+};
 
 #endif
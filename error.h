@@ -17,20 +17,22 @@ enum Status {
 // File and DB errors
 
        BADFILEPTR, BADFILE, FILETABFULL, FILEOPEN, FILENOTOPEN,
-       UNIXERR, BADPAGEPTR, BADPAGENO, FILEEXISTS,
+       UNIXERR, BADPAGEPTR, BADPAGENO, FILEEXISTS, BADPAGESIZE,
 
 // BufMgr and HashTable errors
 
        HASHTBLERROR, HASHNOTFOUND, BUFFEREXCEEDED, PAGENOTPINNED,
-       BADBUFFER, PAGEPINNED,
+       BADBUFFER, PAGEPINNED, PAGESDIRTY,
 
 // Page errors
 	
        NOSPACE,  NORECORDS,  ENDOFPAGE, INVALIDSLOTNO, INVALIDRECLEN,
+       NOTCONTIGUOUS,
 
 // HeapFile errors
 
        BADRID, BADRECPTR, BADSCANPARM, BADSCANID, SCANTABFULL, FILEEOF, FILEHDRFULL,
+       SCANREADONLY,
 
 // Index errors
  
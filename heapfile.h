@@ -10,6 +10,9 @@ using namespace std;
 
 #include "page.h"
 #include "buf.h"
+#include "btree.h"
+#include "log.h"
+#include "readAhead.h"
 
 extern DB db;
 
@@ -19,8 +22,84 @@ extern DB db;
 // Some constant definitions
 const unsigned MAXNAMESIZE = 50;
 
-enum Datatype { STRING, INTEGER, FLOAT };    // attribute data types
-enum Operator { LT, LTE, EQ, GTE, GT, NE };  // scan operators
+// evaluates a scan predicate over n records, setting flags[i] to 1 if
+// recs[i] matches and to 0 otherwise
+typedef void (*BatchKernel)(const Record* recs, const int n,
+                            const int offset, const int length,
+                            const char* filter, unsigned char* flags);
+
+// evaluates a scan predicate over the values of one attribute for n
+// slots of a PAX page, packed length bytes apart, setting flags[i] to 1
+// if slot i holds a record (present[i] is 1) and its value matches
+typedef void (*ColumnKernel)(const char* values, const unsigned char* present,
+                             const int n, const int length,
+                             const char* filter, unsigned char* flags);
+
+// The free space map records, for every page of a heap file, roughly
+// how much free space it has: one byte per page giving the free bytes
+// in units of 1/256 of the page size, rounded down so that it never
+// overstates.  The bytes live on dedicated FSM pages, each covering as
+// many consecutive page numbers as a page has bytes; the header lists
+// them.  Page numbers past what MAXFSMPAGES of them cover (64K with 1K
+// pages) have no entry: inserts look at those pages themselves, a few
+// at a time, when the map has nothing to offer.
+const unsigned MAXFSMPAGES = 64;
+
+// The header also lists the B+-tree indexes on the file, at most one
+// per attribute offset.  Each lives in a file named by indexName.
+const unsigned MAXINDEXES = 4;
+
+struct IndexDesc
+{
+  int		offset;		// byte offset of the attribute
+  int		length;		// length of the attribute
+  Datatype	type;		// datatype of the attribute
+};
+
+const string indexName(const string & fileName, const int offset);
+
+// A zone map keeps, for every data page, the smallest and largest
+// values on it of up to MAXZONEATTRS numeric attributes, together with
+// the page's nextPage link, so that a scan can pass over pages that
+// cannot hold a match without reading them.  The entries live on
+// dedicated pages listed in the header, as many to a page as fit.
+// Inserts widen a page's ranges; deletes leave them as they are, so
+// they may be wider than the records left.  A page without a current
+// entry, because it was changed in place or has not been summarized
+// since the attribute was added, is read and summarized again the next
+// time a scan reaches it.  Page numbers past what MAXZONEPAGES pages of
+// entries cover (5K or so with 1K pages) never have one: scans always
+// read those pages, and they are not summarized.
+const unsigned MAXZONEATTRS = 2;
+const unsigned MAXZONEPAGES = 128;
+
+enum ZoneState { ZONENONE, ZONEVALID, ZONESTALE };
+
+union ZoneValue
+{
+  int		i;
+  float		f;
+};
+
+struct ZoneEntry
+{
+  int		next;		// nextPage of the page
+  ZoneState	state;		// ranges and next can only be used if ZONEVALID
+  ZoneValue	min[MAXZONEATTRS]; // bounds of each attribute on the page;
+  ZoneValue	max[MAXZONEATTRS]; // min > max if it has no values
+};
+
+// The page directory lists the data pages of a file in the order of
+// the page chain, so that the n-th page can be found without walking
+// the chain to it.  It lives on directory pages linked from the header,
+// each a DirPageHdr followed by as many page numbers as fit.  Pages are
+// only ever added at the end of the chain and never leave it, so
+// entries are only ever appended.
+struct DirPageHdr
+{
+  int		next;		// next directory page, -1 for the last one
+  int		count;		// number of page numbers on this page
+};
 
 struct FileHdrPage
 {
@@ -29,13 +108,39 @@ struct FileHdrPage
   int		lastPage;	// pageNo of last data page in file
   int		pageCnt;	// number of pages
   int		recCnt;		// record count
+  int		fsmCnt;		// number of free space map pages
+  int		fsmPages[MAXFSMPAGES]; // pageNo of each free space map page
+  int		indexCnt;	// number of indexes
+  IndexDesc	indexes[MAXINDEXES]; // attribute of each index
+  int		zoneAttrCnt;	// number of attributes in the zone map
+  IndexDesc	zoneAttrs[MAXZONEATTRS]; // attributes in the zone map
+  int		zoneCnt;	// number of zone map pages
+  int		zonePages[MAXZONEPAGES]; // pageNo of each zone map page
+  int		dirFirst;	// pageNo of the first directory page
+  int		dirLast;	// pageNo of the last directory page
+  int		paxAttrCnt;	// attributes of the records if PAX, else 0
+  int		paxWidths[MAXPAXATTRS]; // length of each attribute
+
+  // Every HeapFile open on the file shares this page, and keeps copies
+  // of parts of the file in memory.  Each change to one of those parts
+  // bumps its version here, so that the other HeapFiles can tell their
+  // copy is stale.  Versions only mean anything while the file is open,
+  // and are not logged.
+  int		fsmVersion;	// of the free space map
+  int		indexVersion;	// of the list of indexes
+  int		zoneVersion;	// of the zone map
+  int		dirVersion;	// of the page directory
 };
 
+static_assert(sizeof(FileHdrPage) <= MINPAGESIZE, "header must fit a page");
+
+struct LoggedHeader;	// the header of a file as last logged, in heapfile.C
 
 // class definition of heapFile
 class HeapFile {
 protected:
    File* 	filePtr;        // underlying DB File object
+   int		pageSize;	// size of the pages of the file
    FileHdrPage*  headerPage;	// pinned file header page in buffer pool
    int		headerPageNo;	// page number of header page
    bool		hdrDirtyFlag;   // true if header page has been updated
@@ -45,6 +150,107 @@ protected:
    bool  	curDirtyFlag;   // true if page has been updated
    RID   	curRec;         // rid of last record returned
 
+   // Records of a PAX file are copied out of the page, put back
+   // together: those returned to the caller into recBuf, those only
+   // looked at into scratch.
+   vector<char>	recBuf;
+   RID		recBufRid;	// record in recBuf
+   vector<char>	scratch;
+
+   // the record at rid on page, pointing into the page if it is slotted
+   // and into buf if it is PAX
+   static const Status pageRecord(Page* page, const RID & rid, Record & rec,
+                                  vector<char> & buf);
+   // initialize a new data page, slotted or PAX as the file is
+   void initPage(Page* page, const int pageNo);
+   // false if rec cannot be stored in the file because of its length
+   const bool fitsFile(const Record & rec) const;
+
+   // in-memory copy of the free space map, loaded on first use and
+   // again whenever another HeapFile has changed the map.  For each
+   // category, fsmBuckets holds pages last seen in it; entries go stale
+   // when a page changes category and are dropped lazily.
+   bool		fsmLoaded;
+   int		fsmSeen;	// headerPage->fsmVersion of the copy
+   vector<unsigned char> fsmCat;
+   vector<vector<int> > fsmBuckets;
+
+   const bool fsmStale() const
+     { return !fsmLoaded || fsmSeen != headerPage->fsmVersion; }
+   const Status loadFreeSpaceMap();
+   // record in the free space map that pageNo has freeSpace bytes free
+   const Status setFreeSpace(const int pageNo, const int freeSpace);
+   // find a page with at least needed bytes free; NOSPACE if none
+   const Status findFreePage(const int needed, int & pageNo);
+   // look for one among the pages the map does not cover, going on
+   // along the directory from fsmWalk
+   int		fsmWalk;
+   const Status walkFreePage(const int needed, int & pageNo);
+
+   // the indexes listed in the header, opened on first use and brought
+   // up to date whenever another HeapFile has created or destroyed one
+   bool		indexesOpen;
+   int		indexSeen;	// headerPage->indexVersion of the list
+   vector<BTreeIndex*> indexes;
+
+   const Status openIndexes();
+   // add (or remove) the entries for the record at rid to every index
+   const Status indexRecord(const Record & rec, const RID & rid,
+                            const bool add);
+
+   // in-memory copy of the zone map, loaded on first use and again
+   // whenever another HeapFile has changed the map; pages at or beyond
+   // zoneMap.size() have no entry
+   bool		zoneLoaded;
+   int		zoneSeen;	// headerPage->zoneVersion of the copy
+   vector<ZoneEntry> zoneMap;
+
+   const bool zoneStale() const
+     { return !zoneLoaded || zoneSeen != headerPage->zoneVersion; }
+   // false for the pages past what the map can hold entries for
+   const bool zoneCovers(const int pageNo) const
+     { return (unsigned) pageNo / (pageSize / sizeof(ZoneEntry)) < MAXZONEPAGES; }
+   const Status loadZoneMap();
+   const Status setZone(const int pageNo, const ZoneEntry & entry);
+   // enter pageNo in the zone map from its records
+   const Status summarizeZone(const int pageNo, Page* page);
+   // the zone map entry of page, from its records
+   void zoneSummary(Page* page, ZoneEntry & entry);
+   // widen the ranges of pageNo to take in rec
+   const Status zoneInserted(const int pageNo, const Record & rec);
+   // record that the nextPage of pageNo is now next
+   const Status zoneLinked(const int pageNo, const int next);
+   // note that pageNo was changed in place
+   const Status zoneChanged(const int pageNo);
+
+   // in-memory copy of the page directory, loaded on first use and
+   // again whenever another HeapFile has added to it
+   bool		dirLoaded;
+   int		dirSeen;	// headerPage->dirVersion of the copy
+   vector<int>	pageDir;
+
+   const bool dirStale() const
+     { return !dirLoaded || dirSeen != headerPage->dirVersion; }
+   const Status loadPageDir();
+   // add pageNo, just linked in at the end of the chain, to the directory
+   const Status dirAppend(const int pageNo);
+
+   // With a log open, every change is logged as it is made; none of
+   // this does anything without one.
+   LSN		lastLSN;	// last record logged through this object
+   LoggedHeader* loggedHdr;	// the header as last logged, shared by
+				// every HeapFile open on the file
+
+   // log a change to page pageNo, which must be pinned.  page is given
+   // for data pages, which take the LSN of the record.
+   const Status logChange(const LogRecType type, const int pageNo,
+                          const int arg, const void* body = NULL,
+                          const int length = 0, Page* page = NULL);
+   const Status logHeader();   // log the bytes of the header that changed
+   // end of an operation: log the header and, with synchronous commit,
+   // wait for the log to reach the disk
+   const Status opDone();
+
 public:
 
   // initialize
@@ -56,15 +262,67 @@ public:
   // return number of records in file
   const int getRecCnt() const;
 
-  // given a RID, read record from file, returning pointer and length
+  // return number of data pages in file
+  const int getPageCnt() const;
+
+  // return the size of the pages of the file
+  const int getPageSize() const { return pageSize; }
+
+  // true if the data pages have the PAX layout
+  const bool isPax() const { return headerPage->paxAttrCnt > 0; }
+
+  // given a RID, read record from file, returning pointer and length.
+  // A record of a PAX file is a copy, valid until the next call.
   const Status getRecord(const RID &rid, Record & rec);
+
+  // build a B+-tree index on an attribute from the records in the
+  // file; from then on inserts and deletes keep it up to date, and
+  // scans with an EQ, LT, LTE, GT or GTE predicate on the attribute
+  // use it.  INDEXEXISTS if the offset already has one.
+  const Status createIndex(const int offset, const int length,
+                           const Datatype type);
+
+  // drop the index on the attribute at offset; NOINDEX if there is none
+  const Status destroyIndex(const int offset);
+
+  // throw away every index on the file and build it again from the
+  // records, as recovery does for the files it redid changes to
+  const Status rebuildIndexes();
+
+  // add a numeric attribute to the zone map of the file.  Filtered
+  // scans on it then pass over the pages whose range rules them out.
+  const Status createZoneMap(const int offset, const Datatype type);
+
+  // make every change made through this object so far durable; only
+  // needed without synchronous commit
+  const Status commit();
 };
 
 
+struct ScanGroup;	// the shared scans of a file, in heapfile.C
+
 class HeapFileScan : public HeapFile
 {
 public:
 
+    // Matches found by one worker of a parallel scan, in the order it
+    // found them: their RIDs and copies of the records, laid end to end
+    // in data.
+    struct ScanBuffer
+    {
+        vector<RID>  rids;
+        vector<int>  ends;   // end of each record in data
+        vector<char> data;
+
+        const int size() const { return rids.size(); }
+        Record record(const int i) const
+        {
+            int start = i ? ends[i-1] : 0;
+            Record rec = { (void*) &data[start], ends[i] - start };
+            return rec;
+        }
+    };
+
     HeapFileScan(const string & name, Status & status);
 
     // end filtered scan
@@ -83,15 +341,65 @@ public:
     // return RID of next record that satisfies the scan 
     const Status scanNext(RID& outRid);
 
-    // read current record, returning pointer and length
+    // return the RIDs of, and pointers to, all records that satisfy
+    // the scan on the next page that has any (the rest of the current
+    // page if scanNext stopped partway through it).  The records stay
+    // valid until the scan moves on; afterwards the scan is positioned
+    // at the last record of the page.  Returns FILEEOF when no page
+    // with a matching record is left.
+    const Status scanNextBatch(vector<RID> & outRids, vector<Record> & outRecs);
+
+    // read current record, returning pointer and length.  A record of
+    // a PAX file is a copy, valid until the next call.
     const Status getRecord(Record & rec);
 
     // delete current record 
     const Status deleteRecord();
 
-    // marks current page of scan dirty
+    // marks current page of scan dirty.  In a PAX file, changes made to
+    // the copy getRecord returned for the current record are written
+    // back to the page.  The indexes on attributes the change altered
+    // are brought up to date.
     const Status markDirty();
 
+    // true if the scan is answered from an index, in which case the
+    // records come in order of the attribute
+    const bool isIndexed() const { return index != NULL; }
+
+    // pages the zone map let the scan pass over without reading them
+    const int getSkippedPages() const { return skippedPages; }
+
+    // read up to window pages ahead of the scan in the background;
+    // 0 (the default) turns read-ahead off
+    const Status setReadAhead(const int window);
+
+    // read the pages straight from a read-only memory mapping of the
+    // file instead of copying them into the buffer pool; records then
+    // point into the mapping.  Refused with PAGESDIRTY while the pool
+    // holds unwritten changes to the file.  A mapped scan cannot
+    // delete records or mark pages dirty; endScan unmaps the file.
+    const Status setMapped(const bool on);
+
+    // Share passes over the file with the other shared scans of it.
+    // Each time the scan starts, it joins them at the page the last of
+    // them to move has reached, follows the chain to its end and then
+    // wraps around to the first page and on up to where it joined; with
+    // none running it starts at the first page.  The pages it gets to
+    // have just been read by the others, so scans running together read
+    // the file about once.  The records come in that order; the
+    // predicate and markScan/resetScan are the scan's own.  The scan
+    // starts over at its next scanNext.
+    const Status setShared(const bool on);
+
+    // Run the scan set up by startScan on workers threads at once,
+    // leaving the matches each of them found in buffers[worker].  The
+    // page directory is cut into ranges of consecutive pages that the
+    // workers take one at a time until none is left, so the buffers
+    // together hold every match once, in no particular order.  Pages
+    // are read through the buffer pool and the zone map is used, but an
+    // index is not.  The position of the scan is left as it was.
+    const Status parallelScan(const int workers, vector<ScanBuffer> & buffers);
+
 private:
     int   offset;            // byte offset of filter attribute
     int   length;            // length of filter attribute
@@ -103,10 +411,63 @@ private:
     // of the scan when the method markScan() is invoked.
     // A subsequent invocation of resetScan() will cause the
     // scan to be rolled back to the following
+    bool  marked;            // markScan() has been called
     int   markedPageNo;	// page number of pinned page
     RID   markedRec;         // rid of last record returned
+    bool  markedWrapped;
+
+    BatchKernel kernel;      // predicate specialized for type and op
+    vector<unsigned char> pageFlags; // scratch space for scanNextBatch
+
+    int   paxAttr;           // PAX attribute that is the filter attribute, or -1
+    ColumnKernel columnKernel; // predicate over its values
+    vector<char> batchData;  // records of a PAX page for scanNextBatch
+
+    int   readAheadWindow;   // pages to read ahead, 0 if off
+    ReadAhead* readAhead;    // read-ahead stream while scanning
+
+    const char* mapBase;     // mapping of the file if mapped, else NULL
+    size_t mapLength;        // bytes mapped
+
+    bool  shared;            // set by setShared
+    ScanGroup* group;        // shared scans it runs with, NULL if none
+    int   startPageNo;       // page a shared scan started at, -1 if none
+    bool  wrapped;           // it has gone on from the last page to the first
+
+    int   zoneAttr;          // zone map attribute of the filter, -1 if none
+    int   skippedPages;      // pages passed over thanks to the zone map
+
+    BTreeIndex* index;       // index answering the scan, NULL if none
+    BTreeIndex::Cursor cursor; // position of the scan in index
+    BTreeIndex::Cursor markedCursor;
+
+    // with indexes on the file, a copy of the record getRecord last
+    // returned as it read then, for markDirty to find changed keys
+    vector<char> oldRec;
+    RID   oldRid;
 
     const bool matchRec(const Record & rec) const;
+    const bool matchAttr(const char* attr) const; // the filter attribute matches
+    // set flags[i] for each of the first n slots of a PAX page that hold
+    // a matching record, putting records together in buf if need be
+    void paxFlags(Page* page, const int pageNo, const int n,
+                  unsigned char* flags, vector<char> & buf) const;
+    // scanNextBatch on a PAX page
+    const int paxBatch(vector<RID> & outRids, vector<Record> & outRecs);
+    const Status gotoPage(const int pageNo); // make pageNo the current page
+    const int startPage();      // page to start at, joining the group if shared
+    const int followingPage();  // page after curPage in scan order, -1 at the end
+    void leaveGroup();
+    const bool pageRuledOut();  // zone map says curPage has no match
+    // the zone map has a current entry for pageNo that rules it out
+    const bool zoneRulesOut(const int pageNo) const;
+    void skipPages(int & pageNo); // pass over pages ruled out from pageNo on
+    // next match from the index; ENDOFPAGE if it is not on page pageNo
+    // (when that is not -1)
+    const Status indexNext(RID & outRid, const int pageNo);
+    // bring the indexes up to date with a change to the current record
+    const Status reindex(const Record & rec);
+    void pageReached();      // let read-ahead know curPage is pinned
 };
 
 
@@ -119,8 +480,65 @@ public:
     // end filtered scan
     ~InsertFileScan();
 
-    // insert record into file, returning its RID
+    // insert record into file, returning its RID.  The record goes on
+    // the current page if it fits, else on a page the free space map
+    // says has room, else on a new page appended to the file.
     const Status insertRecord(const Record & rec, RID& outRid); 
+
+private:
+    const Status appendPage(); // add an empty page at the end, make it current
+    const Status leavePage();  // unpin the current page
+};
+
+
+// Appends large numbers of records to a heap file without going through
+// the buffer pool.  Records are packed into page images held by the
+// loader, page numbers are reserved batchPages at a time, and each full
+// batch is written to disk with one call.  The new pages only become
+// part of the file, and the header counts only change, when finish()
+// links them in after the last page.
+
+class BulkLoader : public HeapFile
+{
+public:
+
+    BulkLoader(const string & name, Status & status,
+               const int batchPages = 256);
+
+    // finishes the load if finish() has not been called
+    ~BulkLoader();
+
+    // append record to the load, returning its RID
+    const Status insertRecord(const Record & rec, RID& outRid);
+
+    // write out the last batch and link the loaded pages into the file
+    const Status finish();
+
+private:
+    int   batchPages;    // pages reserved and written at a time
+    char* batch;         // page images of the current batch
+    int   batchFirst;    // page number of batch[0], -1 if none reserved
+    int   batchUsed;     // pages of the batch started so far
+    int   loadFirst;     // first page loaded, -1 if none yet
+    int   loadLast;      // last page written so far
+    int   loadedPages;   // pages written so far
+    int   loadedRecs;    // records in written pages and the batch
+
+    // a page written, with what finish() enters for it in the free
+    // space map and the zone map; it also enters it in the directory
+    struct LoadedPage
+    {
+        int       pageNo;
+        int       freeSpace;
+        ZoneEntry zone;
+    };
+    vector<LoadedPage> loaded;
+
+    const Status flushBatch(const bool more); // write the current batch
+    Page* batchPage(const int i)  // i-th page image of the batch
+    {
+        return (Page*) (batch + (size_t) i * pageSize);
+    }
 };
 
 #endif
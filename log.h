@@ -0,0 +1,147 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <string>
+#include <vector>
+#include "db.h"
+
+// The kinds of log records.  A change to a data page is logged as the
+// operation that made it, and recovery redoes it only if the page on
+// disk carries an older LSN.  Every other page (file headers, free
+// space map, zone map and directory pages) is logged as the bytes that
+// changed, which can be written again any number of times.
+enum LogRecType {
+  LOGINIT,	// data page pageNo was initialized empty
+  LOGLINK,	// nextPage of data page pageNo was set to arg
+  LOGINSERT,	// the body was inserted as a record, getting slot arg
+  LOGDELETE,	// the record in slot arg was deleted
+  LOGUPDATE,	// the record in slot arg was overwritten with the body
+  LOGFORMAT,	// page pageNo was cleared to zeros
+  LOGBYTES,	// the body was written at byte arg of page pageNo
+  LOGDROP	// the file was destroyed
+};
+
+// Each record is this header, the name of the file it is for and then
+// the body.  The checksum lets recovery find where the log was cut off.
+struct LogRecHdr
+{
+  int		length;		// bytes in the record, header included
+  unsigned	check;		// checksum of the bytes after this field
+  LSN		lsn;		// LSN of the record
+  int		type;		// a LogRecType
+  int		pageNo;		// page changed
+  int		arg;		// slot, next page or byte offset, by type
+  int		nameLen;	// bytes in the file name
+};
+
+struct LogStats
+{
+  std::atomic<long> records;	// records appended
+  std::atomic<long> bytes;	// bytes appended
+  std::atomic<long> flushes;	// writes of the log, each followed by fdatasync
+  std::atomic<long> waits;	// flush requests that found records to write
+  std::atomic<long> redone;	// records applied by recovery
+
+  void clear()
+    {
+      records = bytes = flushes = waits = redone = 0;
+    }
+
+  LogStats()
+    {
+      clear();
+    }
+};
+
+
+// A redo write-ahead log.  Records are appended to a buffer in memory
+// and are given LSNs that are their positions in the log, counted from
+// the creation of the log so that they keep growing when it is
+// truncated.  flush() makes the records up to an LSN durable; a thread
+// that asks while another is writing waits for it and then writes
+// everything appended in the meantime with one write and one fdatasync,
+// so concurrent commits share the cost (group commit).
+//
+// The buffer manager does not write a page before the log has been
+// flushed past the last change logged for it, so the log holds every
+// change that is on disk.  After a crash, recover() redoes the log
+// against the files; a checkpoint writes back every page changed since
+// the log was last truncated and then truncates it.
+//
+// Only heap files are logged.  B+-tree index files are not, and are
+// built again after recovery instead; bulk loaded pages are written to
+// disk before they are linked in.
+
+class LogMgr
+{
+public:
+  // open the log in fileName, creating it if there is none.  recover()
+  // must be called before the first record is appended.
+  LogMgr(const string & fileName, Status & status);
+  ~LogMgr();			// writes out the records still in memory
+
+  // append a record for a change to page pageNo of file, returning its LSN
+  const Status append(const LogRecType type, const string & file,
+		      const int pageNo, const int arg, const void* body,
+		      const int length, LSN & lsn);
+
+  // return once every record at or below lsn is on disk
+  const Status flush(const LSN lsn);
+
+  const LSN getEndLSN();	// LSN the next record will get
+  const LSN getFlushedLSN() const { return flushedLSN; }
+
+  // With synchronous commit (the default) every change to a heap file
+  // is durable when the call that made it returns; without it, changes
+  // are durable after HeapFile::commit() or the next flush.
+  void setSyncCommit(const bool on) { syncCommit = on; }
+  const bool getSyncCommit() const { return syncCommit; }
+
+  // microseconds a flush waits for more records to join it, 0 for none
+  void setGroupDelay(const int usecs) { groupDelay = usecs; }
+
+  // Redo every record in the log against the files it names, write the
+  // pages back and sync the files, then empty the log.  Records for
+  // files that no longer exist, or that were destroyed later on, are
+  // passed over.
+  const Status recover(DB & db);
+
+  // Drop the records below upto, all of whose changes are on disk.
+  // Nothing is dropped if records were appended from upto on.
+  const Status truncate(const LSN upto);
+
+  // names of the files with records in the log
+  void loggedFiles(vector<string> & names);
+  // names of the files the last recover() redid records for
+  void recoveredFiles(vector<string> & names);
+
+  const LogStats & getStats() const { return stats; }
+  void clearStats() { stats.clear(); }
+
+private:
+  string	fileName;
+  int		unixFile;
+  std::mutex	latch;		// protects the fields below
+  std::condition_variable flushDone; // signalled when a flush ends
+  vector<char>	buffer;		// records from flushedLSN to endLSN
+  vector<char>	spare;		// buffer being written by a flush
+  LSN		startLSN;	// LSN of the first record in the file
+  LSN		endLSN;		// LSN of the next record
+  std::atomic<LSN> flushedLSN;	// records below it are on disk
+  bool		flushing;	// a flush is writing spare
+  off_t		fileEnd;	// bytes in the log file, zeros past the records
+  set<string>	files;		// files with records in the log
+  set<string>	recovered;	// files recover() redid records for
+  std::atomic<bool> syncCommit;
+  std::atomic<int> groupDelay;
+  LogStats	stats;
+
+  const Status writeHeader();	// write startLSN to the log file
+  const Status extend(const off_t end); // grow the file to at least end
+};
+
+#endif
@@ -11,6 +11,9 @@ struct RID{
 
 const RID NULLRID = {-1,-1};
 
+// position of a record in the write-ahead log; it only ever grows
+typedef long long LSN;
+
 struct Record
 {
   void* data;
@@ -19,40 +22,123 @@ struct Record
 
 // slot structure
 struct slot_t {
-        short	offset;  
-        short	length;  // equals -1 if slot is not in use
+        int	offset;  // for a slot not in use, the next free slot
+        int	length;  // equals -1 if slot is not in use
+};
+
+// The page size of a file is chosen when the file is created and may
+// be any power of two from MINPAGESIZE to MAXPAGESIZE.
+const unsigned MINPAGESIZE = 1024;
+const unsigned MAXPAGESIZE = 65536;
+const unsigned DEFAULTPAGESIZE = 1024;
+const unsigned DPHDRSIZE = 10*sizeof(int)+sizeof(LSN); // size of the page header
+const unsigned DPFIXED = DPHDRSIZE+sizeof(slot_t);
+// a page of pageSize bytes has room for pageSize-DPFIXED bytes of
+// records and slots
+
+// A PAX page holds fixed-length records of at most MAXPAXATTRS
+// attributes, each attribute's values packed together.  PaxAttr says
+// where the values of one attribute start in the page and how long
+// each of them is.
+const unsigned MAXPAXATTRS = 16;
+
+struct PaxAttr {
+        unsigned short	start;  // byte offset of the values in the page
+        unsigned short	width;  // length of each value
 };
 
-const unsigned PAGESIZE = 1024;
-const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(short)+2*sizeof(int);
-const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
-// size of the data area of a page
+// returns true if size can be used as the page size of a file
+inline bool validPageSize(const unsigned size)
+{
+    return size >= MINPAGESIZE && size <= MAXPAGESIZE && (size & (size - 1)) == 0;
+}
 
 // Class definition for a minirel data page.   
-// The design assumes that records are kept compacted when
-// deletions are performed. Notice, however, that the slot
-// array cannot be compacted.  Notice, this class does not keep
-// the records align, relying instead on upper levels to take
+// Deleting a record leaves a hole in the data area and puts its slot
+// on a list of free slots, so both deletes and inserts take constant
+// time.  The holes are only squeezed out when an insert finds too
+// little contiguous space after the last record.  Records never move
+// to another slot, so RIDs stay valid.  Notice, this class does not
+// keep the records align, relying instead on upper levels to take
 // care of non-aligned attributes
+//
+// A Page only declares the fixed header at the front of the page.
+// Records follow it and the slot array grows backwards from the end of
+// the page, wherever that is for the size the page was initialized
+// with, so Page objects are only ever used through pointers into
+// buffers of the right size.
+//
+// A page initialized with initPax instead has the PAX layout: after the
+// header come a PaxAttr for each attribute, a byte per slot saying
+// whether the slot holds a record, and then a minipage per attribute
+// holding the values of that attribute for every slot, one after the
+// other.  A predicate on one attribute thus only reads the bytes of
+// that attribute.  Records have the length of the attributes together
+// and keep their slot; a record is only ever put back together by
+// copying, so getRecord and getRecords do not work on PAX pages, and
+// readRecord and updateRecord work on both kinds.
 
 class Page {
 private:
-    char 	data[PAGESIZE - DPFIXED]; 
-    slot_t 	slot[1]; // first element of slot array - grows backwards!
-    short	slotCnt; // number of slots in use;
-    short	freePtr; // offset of first free byte in data[]
-    short	freeSpace; // number of bytes free in data[]
-    short	dummy;	// for alignment purposes
+    int		slotCnt; // number of slots in use;
+    int		freePtr; // offset of first free byte in data area
+    int		freeSpace; // number of bytes free in data area
+    int		pageSize; // size of the whole page in bytes
     int		nextPage; // forwards pointer
     int		curPage;  // page number of current pointer
+    int		freeSlot; // first slot on the free list, NOFREESLOT if none
+    int		recCnt;   // number of records on the page
+    int		attrCnt;  // attributes of a PAX page, 0 for a slotted page
+    int		capacity; // slots of a PAX page
+    LSN		lsn;      // last logged change to the page, 0 if none
+
+    static const int NOFREESLOT = 1; // slot numbers are <= 0
+
+    // records start right after the header
+    char* data() { return (char*) this + DPHDRSIZE; }
+    const char* data() const { return (const char*) this + DPHDRSIZE; }
+
+    // The slot array grows backwards from slots()[0], the last slot
+    // that fits in the page, so slot i is at slots()[i] for i <= 0.
+    slot_t* slots() { return (slot_t*) ((char*) this + pageSize) - 1; }
+    const slot_t* slots() const { return (const slot_t*) ((const char*) this + pageSize) - 1; }
+
+    // squeeze the holes out of the data area and give back the free
+    // slots at the end of the slot array
+    void compact();
+
+    // the layout of a PAX page
+    PaxAttr* attrs() { return (PaxAttr*) data(); }
+    const PaxAttr* attrs() const { return (const PaxAttr*) data(); }
+    unsigned char* slotMap() { return (unsigned char*) data() + attrCnt * sizeof(PaxAttr); }
+    const unsigned char* slotMap() const { return (const unsigned char*) data() + attrCnt * sizeof(PaxAttr); }
+
+    const Status insertPax(const Record & rec, RID& rid);
+    const Status deletePax(const RID & rid);
+
+    // getRecords for pages of SIZE bytes, or of any size if SIZE is 0
+    template <unsigned SIZE>
+    const int getRecordsSized(RID* rids, Record* recs);
 
 public:
-    void init(const int pageNo); // initialize a new page
+    void init(const int pageNo,
+              const int pageSize); // initialize a new page of pageSize bytes
     void dumpPage() const;       // dump contents of a page
 
+    // initialize a new PAX page of pageSize bytes for records made of
+    // attrCnt attributes of the given widths, one after the other
+    void initPax(const int pageNo, const int pageSize, const int attrCnt,
+                 const int* widths);
+    // records such a page has room for, 0 if not even one fits
+    static const int paxCapacity(const int pageSize, const int attrCnt,
+                                 const int* widths);
+
     const Status getNextPage(int& pageNo) const; // returns value of nextPage
     const Status setNextPage(const int pageNo); // sets value of nextPage to pageNo
-    const short getFreeSpace() const; // returns amount of free space
+    const int getFreeSpace() const; // returns amount of free space
+    const int getPageSize() const; // returns size of the page in bytes
+    const LSN getLSN() const;    // returns LSN of the last logged change
+    void setLSN(const LSN lsn);  // the change logged at lsn has been made
 
     // inserts a new record (rec) into the page, returns RID of record 
     const Status insertRecord(const Record & rec, RID& rid);
@@ -70,6 +156,33 @@ public:
 
     // returns reference to record with RID rid
     const Status getRecord(const RID & rid, Record & rec);
+
+    // copy the record with RID rid into buf, as one piece, and return
+    // its length in length
+    const Status readRecord(const RID & rid, char* buf, int & length) const;
+
+    // overwrite the record with RID rid with rec, of the same length
+    const Status updateRecord(const RID & rid, const Record & rec);
+
+    // returns the number of slots in the slot array, an upper bound
+    // on the number of records on the page
+    const int getSlotCnt() const;
+
+    // PAX pages: the number of attributes (0 for a slotted page), the
+    // values of attribute attr for slots 0 to getSlotCnt()-1, each as
+    // long as the attribute, and a byte per slot, 1 if it holds a record
+    const int getAttrCnt() const { return attrCnt; }
+    const int getRecLength() const; // length of every record, PAX pages only
+    const char* getColumn(const int attr) const
+    {
+        return (const char*) this + attrs()[attr].start;
+    }
+    const unsigned char* getSlotMap() const { return slotMap(); }
+
+    // fills rids and recs with every record on the page in slot order
+    // and returns how many there are; both arrays need room for
+    // getSlotCnt() entries.  Returns 0 for a PAX page.
+    const int getRecords(RID* rids, Record* recs);
 };
 
 #endif
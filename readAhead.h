@@ -0,0 +1,46 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "buf.h"
+
+// Sequential read-ahead along the page chain of a file.  A scan tells
+// its ReadAhead which page it has moved to; the ReadAhead then keeps up
+// to window pages beyond that one coming into the buffer pool from a
+// small pool of background I/O threads shared by all scans.  Pages are
+// brought in with BufMgr::prefetchPage, so read-ahead never waits for a
+// frame and never displaces pinned or recently referenced pages.
+
+class ReadAhead
+{
+public:
+  ReadAhead(File* file, const int window);
+  ~ReadAhead(); // cancels outstanding read-ahead and waits for it
+
+  // the scan now has pageNo pinned; nextPageNo is its nextPage link
+  void advance(const int pageNo, const int nextPageNo);
+
+  // wait until no I/O thread is reading ahead for us
+  void wait();
+
+  // number of threads doing read-ahead I/O; takes effect before the
+  // first ReadAhead is created
+  static void setIOThreads(const int threads);
+
+  void run(); // called from an I/O thread
+
+private:
+  File*	  file;
+  int	  window;		// pages to keep ahead of the scan
+  std::mutex latch;		// protects everything below
+  std::condition_variable idle;	// signalled when busy goes false
+  std::deque<int> ahead;	// pages read ahead, not yet reached
+  int	  nextPageNo;		// next page to read ahead, -1 at the end
+  unsigned generation;		// bumped when the scan jumps
+  bool	  busy;			// an I/O thread is working for us
+  bool	  cancelled;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "heapfile.h"
+
+struct SortStats
+{
+  long		records;	// records sorted
+  int		runs;		// sorted runs written to temporary files
+  int		passes;		// merge passes, 0 if the input fit in memory
+  int		fanIn;		// most runs merged at a time
+  long		runRecords;	// records written to temporary files
+
+  void clear()
+    {
+      records = runs = passes = fanIn = runRecords = 0;
+    }
+
+  SortStats()
+    {
+      clear();
+    }
+};
+
+
+// External merge sort of the records of a heap file by one attribute.
+// The records a scan returns are gathered in memory, up to a budget of
+// a share of the frames of the buffer pool; each time the budget fills
+// they are sorted and written out as a run, a temporary heap file.
+// The runs are then merged, as many at a time as the budget has frames
+// for, until one merge writes the output file.  If every record fits
+// in the budget, they are sorted in memory and no run is written.
+// Runs and the output are written with a BulkLoader, the InsertFileScan
+// for loading whole files, which keeps them out of the buffer pool and
+// the log.
+//
+// The sort is stable: records with equal keys keep the order the scan
+// returned them in.  Records too short to hold the key come first.
+
+class HeapSort
+{
+public:
+
+  // sort on the attribute (offset, length, type), using memShare of
+  // the frames of the pool; BADSORTPARM if either is out of range
+  HeapSort(const int offset, const int length, const Datatype type,
+	   const double memShare, Status & status);
+
+  // Create the heap file outName, with the page size of the scanned
+  // file, and fill it with the records scan returns from where it is,
+  // in order.  The temporary files are named after outName and are
+  // destroyed before sort() returns.
+  const Status sort(HeapFileScan & scan, const string & outName);
+
+  const SortStats & getStats() const { return stats; }
+
+private:
+  int		offset;		// attribute sorted on
+  int		length;
+  Datatype	type;
+  double	memShare;	// share of the buffer pool frames to use
+  SortStats	stats;
+
+  // one record held in memory, its bytes at pos in the arena
+  struct Entry
+  {
+    size_t	pos;
+    int		length;
+  };
+
+  // < 0, 0 or > 0 as the key of rec a is below, equal to or above that
+  // of b, a missing key being below every other
+  const int compare(const Record & a, const Record & b) const;
+
+  // sort the records in memory and write them to the heap file name
+  const Status writeRun(vector<char> & arena, vector<Entry> & entries,
+			const string & name, const int pageSize);
+
+  // merge the runs named into the heap file name, then destroy them
+  const Status merge(const vector<string> & runs, const string & name,
+		     const int pageSize);
+};
+
+#endif